@@ -8,15 +8,24 @@
 #include <fcntl.h>      // Required for open, O_WRONLY, O_CREAT, O_TRUNC, 0644
 #include <stdio.h>      // Required for printf, snprintf, fprintf, stderr, stdout
 #include <stdlib.h>     // Required for malloc, free, exit
-#include <string.h>     // Required for strtok, strtok_r, strcmp, strlen, strdup, strtok, strtok_r
-#include <sys/wait.h>   // Required for waitpid
+#include <string.h>     // Required for strcmp, strlen, strdup, memcpy, memchr
+#include <sys/wait.h>   // Required for waitpid, wait4
+#include <sys/resource.h> // Required for struct rusage
+#include <time.h>       // Required for clock_gettime, CLOCK_MONOTONIC
 #include <unistd.h>     // Required for access, execv, fork, getpid, pipe, dup2, close, chdir
 #include <ctype.h>      // Required for isspace
+#include <errno.h>      // Required for errno, EINTR
+#include <limits.h>     // Required for INT_MAX
+#include <sys/stat.h>   // Required for fstat, S_ISREG
 
 // define constants
 #define MAX_INPUT_SIZE 255
-#define MAX_ARGS 64
+#define INITIAL_ARGS 8
+#define INITIAL_CAPACITY 8
 #define INITIAL_PATH_SIZE 1
+#define SCRIPT_BLOCK_SIZE 65536
+#define ARENA_BLOCK_SIZE 4096
+#define ARENA_ALIGN 16
 
 // Handle Error Messages (Item 6 - Program Errors)
 char error_message[30] = "An error has occurred\n";
@@ -42,91 +51,271 @@ void update_path(char **new_path, int new_size) {
     path_size = new_size;           // set the new path size
 }
 
-// Helper function to parse and validate a single command
-int parse_command(char *input, char **args, char **output_file) {
-    int arg_count = 0;                                      // start counting arguments at 0
-    *output_file = NULL;                                    // keep track of an output file if found
+// Handle Job Scheduling (Item 5 - Parallel Commands)
+struct job {
+    pid_t pid;                      // process ID of the running command (0 if the slot is free)
+    char *command;                  // name of the running command
+    struct timespec start;          // when the command was launched
+};
+int max_jobs;                       // maximum number of parallel commands running at once
+void initialize_max_jobs() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);  // default to the number of online CPUs
+    max_jobs = cpus > 0 ? (int)cpus : 1;        // fall back to running one command at a time
+}
 
-    char *token = strtok(input, " \t");                     // tokenize the input by splitting at the space or tab character
-    int redirection_found = 0;                              // flag to check if redirection is found
+// Handle Resource Accounting (time and stats built-ins)
+struct usage {
+    double wall;                    // elapsed wall-clock seconds
+    double user;                    // user CPU seconds
+    double sys;                     // system CPU seconds
+    long max_rss;                   // peak resident set size in kilobytes
+    long voluntary_switches;        // context switches while waiting (e.g. on I/O)
+    long involuntary_switches;      // context switches forced by the scheduler
+};
+struct stats_record {
+    int group;                      // parallel group number (0 for a single command)
+    char *command;                  // command name (NULL for a group summary)
+    struct usage usage;             // for a group: whole-group wall time, summed CPU time and context switches, maximum RSS
+    double critical_path;           // for a group: wall time of its slowest command
+};
+FILE *stats_file = NULL;            // where to write the session stats on exit (NULL if disabled)
+struct stats_record *stats = NULL;  // records collected since stats was enabled
+int stats_count = 0;
+int stats_capacity = 0;
+int group_count = 0;                // number of parallel groups run so far
+
+// Helper function to get the seconds elapsed since start
+double elapsed_since(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
 
-    while (token != NULL && arg_count < MAX_ARGS - 1) {     // store each token in the arguments array unless the max number of args is reached
-        if (strcmp(token, ">") == 0) {                      // check if the token is a redirection
-            if (redirection_found || arg_count == 0) {      // if there is a ">" despite already finding redirection or if there are no arguments before the found redirection
-                return -1;                                  // Error: More than one redirection or no arguments before redirection
-            }
-            redirection_found = 1;                          // set the redirection flag
-            token = strtok(NULL, " \t");                    // get the next token
-            if (token == NULL) {                            // if no token is found after the redirection
-                return -1;                                  // Error: No filename after redirection
-            }
-            *output_file = token;                           // store the output file
-        } else if (redirection_found) {                     // check if redirection is found
-            return -1;                                      // Error: More arguments after redirection
-        } else {
-            args[arg_count++] = token;                      // store the token in the arguments array
+// Helper function to convert the rusage of a reaped child into a usage
+void fill_usage(struct usage *usage, struct rusage *rusage, double wall) {
+    usage->wall = wall;
+    usage->user = rusage->ru_utime.tv_sec + rusage->ru_utime.tv_usec / 1e6;
+    usage->sys = rusage->ru_stime.tv_sec + rusage->ru_stime.tv_usec / 1e6;
+    usage->max_rss = rusage->ru_maxrss;                     // already in kilobytes on Linux
+    usage->voluntary_switches = rusage->ru_nvcsw;
+    usage->involuntary_switches = rusage->ru_nivcsw;
+}
+
+// Add a record to the session stats (does nothing unless stats is enabled)
+void record_stats(int group, char *command, struct usage *usage, double critical_path) {
+    if (stats_file == NULL) return;
+    if (stats_count == stats_capacity) {                    // grow the record list
+        stats_capacity = stats_capacity > 0 ? stats_capacity * 2 : INITIAL_CAPACITY;
+        stats = realloc(stats, sizeof(struct stats_record) * stats_capacity);
+    }
+    stats[stats_count].group = group;
+    stats[stats_count].command = command != NULL ? strdup(command) : NULL;  // the command name lives in the line arena
+    stats[stats_count].usage = *usage;
+    stats[stats_count].critical_path = critical_path;
+    stats_count++;
+}
+
+// Write the session stats to the stats file and free the records
+void write_stats() {
+    if (stats_file != NULL) {                               // opened by the stats built-in
+        fprintf(stats_file, "kind\tgroup\tcommand\twall_s\tcritical_s\tuser_s\tsys_s\tmax_rss_kb\tvol_csw\tinvol_csw\n");
+        for (int i = 0; i < stats_count; i++) {
+            struct stats_record *record = &stats[i];
+            fprintf(stats_file, "%s\t%d\t%s\t%.6f\t%.6f\t%.6f\t%.6f\t%ld\t%ld\t%ld\n",
+                    record->command != NULL ? "command" : "group", record->group,
+                    record->command != NULL ? record->command : "-",
+                    record->usage.wall, record->command != NULL ? record->usage.wall : record->critical_path,
+                    record->usage.user, record->usage.sys, record->usage.max_rss,
+                    record->usage.voluntary_switches, record->usage.involuntary_switches);
+        }
+        fclose(stats_file);
+    }
+    for (int i = 0; i < stats_count; i++) {                 // free each record
+        free(stats[i].command);
+    }
+    free(stats);
+}
+
+// Handle Line Memory (per-line arena)
+// Every line is parsed into memory taken from an arena of reusable blocks.
+// Resetting the arena makes all of its blocks available again without freeing them,
+// so after the first few lines parsing a command line does no heap allocation.
+struct arena_block {
+    struct arena_block *next;       // next block in the chain (NULL if this is the last one)
+    size_t size;                    // number of usable bytes in data
+    char data[];                    // memory handed out by arena_alloc
+};
+struct arena {
+    struct arena_block *head;       // first block in the chain
+    struct arena_block *current;    // block currently being handed out
+    size_t used;                    // bytes of the current block already handed out
+};
+struct arena line_arena;            // arena shared by every parsed line
+
+void *arena_alloc(struct arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);                  // keep every allocation aligned
+    while (arena->current == NULL || arena->used + size > arena->current->size) {  // current block is full (or there is none)
+        if (arena->current != NULL && arena->current->next != NULL) {               // reuse the next block kept from an earlier line
+            arena->current = arena->current->next;
+            arena->used = 0;
+            continue;
+        }
+        size_t block_size = ARENA_BLOCK_SIZE;
+        if (arena->current != NULL && arena->current->size * 2 > block_size) {     // grow blocks geometrically
+            block_size = arena->current->size * 2;
         }
-        token = strtok(NULL, " \t");                        // get the next token
+        if (size > block_size) {                                                    // make sure the request fits
+            block_size = size;
+        }
+        struct arena_block *block = malloc(sizeof(struct arena_block) + block_size);
+        block->next = NULL;
+        block->size = block_size;
+        if (arena->current == NULL) {                                               // first block of the arena
+            arena->head = block;
+        } else {                                                                    // append to the end of the chain
+            arena->current->next = block;
+        }
+        arena->current = block;
+        arena->used = 0;
     }
-    args[arg_count] = NULL;                                 // set the last argument to NULL
-    return arg_count;                                       
+    void *memory = arena->current->data + arena->used;
+    arena->used += size;
+    return memory;
 }
 
-int execute_parallel_commands(char **commands, int command_count) {
-    pid_t pids[command_count];                              // store the process IDs of the child processes
+void arena_reset(struct arena *arena) {
+    arena->current = arena->head;   // start handing out the first block again
+    arena->used = 0;
+}
 
-    for (int i = 0; i < command_count; i++) {               // for each command
-        char *args[MAX_ARGS];                               // create a new array to store the arguments
-        int arg_count = 0;                                  // start counting arguments at 0
-        char *output_file = NULL;                           // keep track of an output file if found
-        char *token = strtok(commands[i], " \t");           // tokenize the command by splitting at the space or tab character
-
-        while (token != NULL && arg_count < MAX_ARGS - 1) { // store each token in the arguments array unless the max number of args is reached
-            if (strcmp(token, ">") == 0) {                  // check if the token is a redirection
-                token = strtok(NULL, " \t");                // get the next token
-                if (token != NULL && output_file == NULL) { // if there is a token after the redirection and no output file is found
-                    output_file = token;                    // store the output file
-                } else {                                    // if there is no token after the redirection or an output file is already found
-                    print_error();                          // print an error message
-                    return -1;                              // return an error
+void arena_free(struct arena *arena) {
+    while (arena->head != NULL) {   // free each block
+        struct arena_block *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+    arena->current = NULL;
+    arena->used = 0;
+}
+
+// Handle Command Parsing (Item 4 - Redirection, Item 5 - Parallel Commands)
+struct command {
+    char **args;                    // null-terminated argument list (args[0] is the command)
+    int arg_count;                  // number of arguments
+    char *output_file;              // redirection target (NULL if there is none)
+};
+struct command_line {
+    struct command *commands;       // commands separated by "&"
+    int command_count;              // number of non-empty commands
+};
+
+// Helper function to grow an arena-backed array by copying it into a block twice the size
+void *arena_grow(struct arena *arena, void *items, int *capacity, size_t item_size) {
+    int new_capacity = *capacity > 0 ? *capacity * 2 : INITIAL_ARGS;
+    void *new_items = arena_alloc(arena, new_capacity * item_size);
+    if (*capacity > 0) {
+        memcpy(new_items, items, *capacity * item_size);
+    }
+    *capacity = new_capacity;
+    return new_items;
+}
+
+// Parse a whole line in a single pass.
+// Words are unquoted in place inside the line (unquoting only ever shrinks a word),
+// while the command and argument arrays are taken from the arena.
+// Quoting: '...' is literal, "..." allows \" and \\, and \ escapes the next character outside quotes.
+// Returns 0 on success or -1 if the line is malformed.
+int parse_line(char *line, struct arena *arena, struct command_line *result) {
+    struct command *commands = NULL;
+    int command_count = 0, command_capacity = 0;
+    char **args = NULL;                                         // arguments of the command being built
+    int arg_count = 0, arg_capacity = 0;
+    char *output_file = NULL;                                   // keep track of an output file if found
+    int redirection_pending = 0;                                // flag to check if a ">" is waiting for its filename
+
+    char *read = line;
+    while (1) {
+        while (isspace((unsigned char)*read)) read++;           // skip whitespace between words
+        char delimiter = *read;                                 // character that ends the current word (or an operator)
+
+        if (delimiter != '\0' && delimiter != '&' && delimiter != '>') {
+            // Scan one word, removing quotes and escapes as we go
+            char *word = read;
+            char *write = read;
+            while (*read != '\0' && !isspace((unsigned char)*read) && *read != '&' && *read != '>') {
+                if (*read == '\'') {                            // single quotes: copy everything up to the closing quote
+                    read++;
+                    while (*read != '\0' && *read != '\'') *write++ = *read++;
+                    if (*read == '\0') return -1;               // Error: unterminated quote
+                    read++;
+                } else if (*read == '"') {                      // double quotes: only \" and \\ are escapes
+                    read++;
+                    while (*read != '\0' && *read != '"') {
+                        if (*read == '\\' && (read[1] == '"' || read[1] == '\\')) read++;
+                        *write++ = *read++;
+                    }
+                    if (*read == '\0') return -1;               // Error: unterminated quote
+                    read++;
+                } else if (*read == '\\' && read[1] != '\0') {  // backslash escapes the next character
+                    read++;
+                    *write++ = *read++;
+                } else {
+                    *write++ = *read++;
                 }
+            }
+            delimiter = *read;                                  // remember the delimiter before it can be overwritten
+            *write = '\0';                                      // terminate the word
+            if (delimiter != '\0') read++;                      // move past the delimiter
+
+            if (redirection_pending) {                          // the word is the redirection target
+                output_file = word;
+                redirection_pending = 0;
+            } else if (output_file != NULL) {
+                return -1;                                      // Error: More arguments after redirection
             } else {
-                args[arg_count++] = token;                  // store the token in the arguments array
+                if (arg_count + 1 >= arg_capacity) {            // keep room for the null terminator
+                    args = arena_grow(arena, args, &arg_capacity, sizeof(char *));
+                }
+                args[arg_count++] = word;                       // store the word in the arguments array
             }
-            token = strtok(NULL, " \t");                    // get the next token
-        }
-        args[arg_count] = NULL;                             // set the last argument to NULL
-
-        if (arg_count == 0) continue;                       // if there are no arguments, continue to the next command
-
-        pid_t pid = fork();                                 // create a new process for each command
-        // Child Process
-        if (pid == 0) {
-            execute_command(args[0], args, output_file);    // execute the command
-            exit(0);
-        } 
-        // Parent Process
-        else if (pid > 0) {
-            pids[i] = pid;                                  // store the process ID
-        } 
-        // Fork Failed
-        else {
-            print_error();
-            return -1;
+            if (isspace((unsigned char)delimiter)) continue;    // plain word separator
+        } else if (delimiter != '\0') {
+            read++;                                             // move past the operator
         }
-    }
 
-    // each command has been forked, now wait for all child processes to complete
-    for (int i = 0; i < command_count; i++) {
-        int status;
-        waitpid(pids[i], &status, 0); // wait for the child process to complete
+        if (delimiter == '>') {                                 // check if the operator is a redirection
+            if (redirection_pending || output_file != NULL || arg_count == 0) {
+                return -1;                                      // Error: More than one redirection or no arguments before redirection
+            }
+            redirection_pending = 1;
+        } else if (delimiter == '&' || delimiter == '\0') {     // end of the current command
+            if (redirection_pending) {
+                return -1;                                      // Error: No filename after redirection
+            }
+            if (arg_count > 0) {                                // skip empty commands
+                if (command_count == command_capacity) {
+                    commands = arena_grow(arena, commands, &command_capacity, sizeof(struct command));
+                }
+                args[arg_count] = NULL;                         // set the last argument to NULL
+                commands[command_count].args = args;
+                commands[command_count].arg_count = arg_count;
+                commands[command_count].output_file = output_file;
+                command_count++;
+            }
+            args = NULL;                                        // start a new command
+            arg_count = arg_capacity = 0;
+            output_file = NULL;
+            if (delimiter == '\0') break;                       // end of the line
+        }
     }
 
+    result->commands = commands;
+    result->command_count = command_count;
     return 0;
 }
 
-// Execute a single command 
-int execute_command(char *command, char **args, char *output_file) {
+// Launch a single command without waiting for it, returning the child's process ID (or -1 on error)
+pid_t launch_command(char *command, char **args, char *output_file) {
     for (int i = 0; i < path_size; i++) {                                           // for each path in the path array
         char full_path[MAX_INPUT_SIZE];                                             // create a buffer to store the full path
         snprintf(full_path, sizeof(full_path), "%s/%s", path[i], command);          // concatenate the path and command to create the full path
@@ -153,9 +342,7 @@ int execute_command(char *command, char **args, char *output_file) {
             } 
             // Parent Process
             else if (pid > 0) {
-                int status;
-                waitpid(pid, &status, 0);
-                return 0;
+                return pid;                 // let the caller decide when to wait for the child
             } 
             // Fork Failed
             else {
@@ -168,121 +355,438 @@ int execute_command(char *command, char **args, char *output_file) {
     return -1;
 }
 
-// Helper function to trim leading and trailing whitespace
-char* trim(char* str) {
-    if (!str) return NULL;                                  // Handle NULL pointer    
-    while (isspace((unsigned char)*str)) str++;             // Trim leading whitespace
-    if (*str == 0) return str;                              // check if the string is empty
-    
-    // Trim trailing whitespace
-    char* end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end)) end--;
-    
-    // Write new null terminator
-    *(end + 1) = '\0';
-    return str;
+// Execute a single command, wait for it to complete, and report its resource usage
+int execute_command(char *command, char **args, char *output_file, struct usage *usage) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);                     // start timing before the fork
+    pid_t pid = launch_command(command, args, output_file);    // start the command
+    if (pid == -1) {                                            // command not found or fork failed
+        return -1;
+    }
+    int status;
+    struct rusage rusage;
+    while (wait4(pid, &status, 0, &rusage) == -1) {             // wait for the child process to complete (and collect its usage)
+        if (errno != EINTR) return -1;                          // retry only if interrupted by a signal
+    }
+    fill_usage(usage, &rusage, elapsed_since(&start));
+    record_stats(0, command, usage, 0);
+    return 0;
 }
 
-// Helper function to check if a string is empty or contains only whitespace
-int is_empty_or_whitespace(const char* str) {
-    while (*str) {                              // iterate through the string
-        if (!isspace((unsigned char)*str))      // check if the character is not a whitespace
-            return 0;                           // return false
-        str++;                                  // move to the next character
+// Wait for whichever running job finishes first and free its slot in the job table
+int reap_job(struct job *jobs, int job_slots, struct usage *usage) {
+    while (1) {
+        int status;
+        struct rusage rusage;
+        pid_t pid = wait4(-1, &status, 0, &rusage);         // reap children in completion order, not launch order
+        if (pid == -1) {
+            if (errno == EINTR) continue;                   // interrupted by a signal, try again
+            return -1;                                      // no children left to wait for
+        }
+        for (int i = 0; i < job_slots; i++) {               // find the finished child in the job table
+            if (jobs[i].pid == pid) {
+                jobs[i].pid = 0;                            // mark the slot as free
+                fill_usage(usage, &rusage, elapsed_since(&jobs[i].start));
+                return i;
+            }
+        }
     }
-    return 1;                                   // return true if the string is empty or contains only whitespace
 }
 
-int main(int argc, char *argv[]) {
-    (void)argv;                         // suppress unused variable warning
+// Add a finished job to its group's totals and to the session stats
+void account_job(struct job *job, int group, struct usage *usage, struct usage *total, double *critical_path) {
+    record_stats(group, job->command, usage, 0);
+    total->user += usage->user;
+    total->sys += usage->sys;
+    if (usage->max_rss > total->max_rss) total->max_rss = usage->max_rss;
+    total->voluntary_switches += usage->voluntary_switches;
+    total->involuntary_switches += usage->involuntary_switches;
+    if (usage->wall > *critical_path) *critical_path = usage->wall;    // the slowest command bounds the group
+}
 
-    if (argc > 1) {                     // check if there are any arguments
-        print_error();
-        exit(1);
+int execute_parallel_commands(struct command *commands, int command_count) {
+    int job_slots = command_count < max_jobs ? command_count : max_jobs;   // never run more than max_jobs commands at once
+    struct job *jobs = calloc(job_slots, sizeof(struct job));               // job table of running commands (all slots start free)
+    int running = 0;                                        // number of occupied slots in the job table
+    int group = ++group_count;                              // number this group for the session stats
+    struct usage usage;                                     // usage of the most recently reaped command
+    struct usage total = {0};                               // usage of the whole group
+    double critical_path = 0;                               // wall time of the slowest command in the group
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < command_count; i++) {               // for each command
+        if (running == job_slots) {                         // every slot is busy, wait for the first command to finish
+            int slot = reap_job(jobs, job_slots, &usage);
+            if (slot == -1) {                               // no children left, the job table is stale
+                memset(jobs, 0, job_slots * sizeof(struct job));
+                running = 0;
+            } else {
+                account_job(&jobs[slot], group, &usage, &total, &critical_path);
+                running--;
+            }
+        }
+
+        struct timespec launched;
+        clock_gettime(CLOCK_MONOTONIC, &launched);
+        pid_t pid = launch_command(commands[i].args[0], commands[i].args, commands[i].output_file);    // start the command in the background
+        if (pid == -1) continue;                            // error already printed, move on to the next command
+
+        for (int j = 0; j < job_slots; j++) {               // store the process ID in a free slot
+            if (jobs[j].pid == 0) {
+                jobs[j].pid = pid;
+                jobs[j].command = commands[i].args[0];
+                jobs[j].start = launched;
+                break;
+            }
+        }
+        running++;
     }
-    initialize_path();                  // initialize the path
 
-    char *input = NULL;                 // store the input
-    size_t input_size = 0;              // store the size of the input
-    ssize_t line_length;                // store the length of the input
+    // each command has been launched, now wait for the remaining child processes to complete
+    while (running > 0) {
+        int slot = reap_job(jobs, job_slots, &usage);
+        if (slot == -1) break;
+        account_job(&jobs[slot], group, &usage, &total, &critical_path);
+        running--;
+    }
 
-    while (1) {
-        printf("rush> ");               // print the prompt
-        fflush(stdout);                 // flush the output buffer to ensure the prompt is displayed
+    total.wall = elapsed_since(&start);
+    record_stats(group, NULL, &total, critical_path);       // summarize the group
+    free(jobs);
+    return 0;
+}
 
-        line_length = getline(&input, &input_size, stdin);  // read the input from the user
+// Run a parsed line, returning 1 if the shell should exit
+int run_command_line(struct command_line *parsed) {
+    if (parsed->command_count == 0) {
+        return 0;  // All parallel commands were empty
+    }
 
-        if (line_length == -1) {        // check if the input is empty
-            break;
+    // Handle Parallel Commands if found (Item 5 - Parallel Commands)
+    if (parsed->command_count > 1) {
+        execute_parallel_commands(parsed->commands, parsed->command_count);    // execute the parallel commands
+        return 0;
+    }
+
+    // Handle Single Command
+    char **args = parsed->commands[0].args;                 // store the arguments
+    int arg_count = parsed->commands[0].arg_count;          // store the number of arguments
+    char *output_file = parsed->commands[0].output_file;    // store the output file if found
+
+    // Handle Built-in Commands (Item 3 - Built-in Commands)
+    if (strcmp(args[0], "exit") == 0) {         // check if the command is "exit"
+        if (arg_count > 1) {                    // should be the only argument
+            print_error();
+        } else {
+            return 1;
+        }
+    } else if (strcmp(args[0], "cd") == 0) {    // check if the command is "cd"
+        if (arg_count != 2) {                   // should have exactly 1 argument
+            print_error();
+        } else if (chdir(args[1]) != 0) {       // if change in directory is unsuccessful
+            print_error();
         }
+    } else if (strcmp(args[0], "path") == 0) {                          // check if the command is "path"
+        char **new_path = malloc(sizeof(char *) * (arg_count - 1));     // allocate memory for the new path
+        for (int i = 1; i < arg_count; i++) {                           // for each path in the arguments
+            new_path[i - 1] = strdup(args[i]);                          // store the path in the new path
+        }
+        update_path(new_path, arg_count - 1);                           // update the path
+    } else if (strcmp(args[0], "maxjobs") == 0) {                       // check if the command is "maxjobs"
+        char *end;
+        long limit = arg_count == 2 ? strtol(args[1], &end, 10) : 0;    // should have exactly 1 argument
+        if (limit <= 0 || limit > INT_MAX || *end != '\0') {            // limit must be a positive integer
+            print_error();
+        } else {
+            max_jobs = (int)limit;                                      // update the parallel command limit
+        }
+    } else if (strcmp(args[0], "time") == 0) {                          // check if the command is "time"
+        struct usage usage;
+        if (arg_count < 2) {                                            // should have a command to time
+            print_error();
+        } else if (execute_command(args[1], args + 1, output_file, &usage) == 0) {
+            char report[MAX_INPUT_SIZE];                                // report on stderr so redirection only captures the command
+            int length = snprintf(report, sizeof(report), "real %.3fs user %.3fs sys %.3fs maxrss %ldKB csw %ld/%ld\n",
+                                  usage.wall, usage.user, usage.sys, usage.max_rss,
+                                  usage.voluntary_switches, usage.involuntary_switches);
+            write(STDERR_FILENO, report, length);
+        }
+    } else if (strcmp(args[0], "stats") == 0) {                         // check if the command is "stats"
+        if (arg_count != 2) {                                           // should have exactly 1 argument
+            print_error();
+        } else {
+            FILE *file = fopen(args[1], "we");                          // open now so the path is relative to the current directory (close-on-exec)
+            if (file == NULL) {                                         // file cannot be opened
+                print_error();
+            } else {
+                if (stats_file != NULL) {                               // replace the previous stats file
+                    fclose(stats_file);
+                }
+                stats_file = file;                                      // write the session stats to this file on exit
+            }
+        }
+    } else {
+        struct usage usage;
+        execute_command(args[0], args, output_file, &usage);            // execute the command
+    }
+    return 0;
+}
 
-        if (input[line_length - 1] == '\n') {   // remove the newline character from the input
-            input[line_length - 1] = '\0';      // replace the newline character with a null terminator
+// Process one line of input, returning 1 if the shell should exit
+int process_line(char *line) {
+    struct command_line parsed;
+    arena_reset(&line_arena);                           // reuse the memory of the previous line
+    if (parse_line(line, &line_arena, &parsed) == -1) { // check if there was an error parsing the line
+        print_error();
+        return 0;
+    }
+    return run_command_line(&parsed);
+}
+
+// Helper function to check if a command is a built-in command (which changes shell state)
+int is_builtin(const char *command) {
+    static const char *builtins[] = {"exit", "cd", "path", "maxjobs", "time", "stats"};
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        if (strcmp(command, builtins[i]) == 0) {
+            return 1;
         }
+    }
+    return 0;
+}
 
-        char *trimmed_input = trim(input);              // trim leading and trailing whitespace from the input
-        if (is_empty_or_whitespace(trimmed_input)) {    // check if the input is empty or contains only whitespace
-            continue;
+// Read the whole script file into one null-terminated buffer using large block reads
+char *read_script(const char *filename, size_t *length) {
+    int fd = open(filename, O_RDONLY);                      // open the script file
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {                             // get the file size so the buffer is allocated once
+        close(fd);
+        return NULL;
+    }
+    int regular = S_ISREG(st.st_mode) && st.st_size > 0;   // a regular file can be read into a buffer of exactly its size
+    size_t capacity = regular ? (size_t)st.st_size : SCRIPT_BLOCK_SIZE;
+    char *script = malloc(capacity + 1);                    // leave room for the null terminator
+    size_t used = 0;
+    while (1) {
+        if (used == capacity) {
+            if (regular) break;                             // the whole file has been read
+            capacity *= 2;                                  // not a regular file, so grow the buffer
+            script = realloc(script, capacity + 1);
+        }
+        size_t want = capacity - used;
+        ssize_t got = read(fd, script + used, want < SCRIPT_BLOCK_SIZE ? want : SCRIPT_BLOCK_SIZE);
+        if (got == -1) {
+            if (errno == EINTR) continue;                   // interrupted by a signal, try again
+            free(script);
+            close(fd);
+            return NULL;
+        }
+        if (got == 0) break;                                // end of file (the file may have shrunk)
+        used += got;
+    }
+    close(fd);
+    script[used] = '\0';                                    // terminate the last line even without a trailing newline
+    *length = used;
+    return script;
+}
+
+// Handle File Dependencies (batch -p mode)
+// A set of file names kept in an open-addressing hash table taken from the line arena,
+// so checking a line against the gathered commands does not grow with the script length.
+struct name_set {
+    char **slots;                   // table of names (NULL if the slot is empty)
+    size_t capacity;                // number of slots (a power of two, or 0 before the first add)
+    size_t count;                   // number of names in the set
+};
+
+// Helper function to hash a name (FNV-1a)
+size_t hash_name(const char *name) {
+    size_t hash = 14695981039346656037ULL;
+    while (*name) {
+        hash = (hash ^ (unsigned char)*name++) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+int name_set_contains(struct name_set *set, const char *name) {
+    if (set->count == 0) return 0;
+    for (size_t i = hash_name(name) & (set->capacity - 1); set->slots[i] != NULL; i = (i + 1) & (set->capacity - 1)) {
+        if (strcmp(set->slots[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+void name_set_add(struct arena *arena, struct name_set *set, char *name) {
+    if ((set->count + 1) * 2 > set->capacity) {             // keep the table at most half full
+        size_t old_capacity = set->capacity;
+        char **old_slots = set->slots;
+        set->capacity = old_capacity > 0 ? old_capacity * 2 : INITIAL_CAPACITY;
+        set->slots = arena_alloc(arena, sizeof(char *) * set->capacity);   // the old table is reclaimed when the arena is reset
+        memset(set->slots, 0, sizeof(char *) * set->capacity);
+        set->count = 0;
+        for (size_t i = 0; i < old_capacity; i++) {         // move the names into the larger table
+            if (old_slots[i] != NULL) name_set_add(arena, set, old_slots[i]);
         }
+    }
+    size_t i = hash_name(name) & (set->capacity - 1);
+    while (set->slots[i] != NULL) {                         // find the name or the first empty slot
+        if (strcmp(set->slots[i], name) == 0) return;       // already in the set
+        i = (i + 1) & (set->capacity - 1);
+    }
+    set->slots[i] = name;
+    set->count++;
+}
 
-        // Handle Parallel Commands if found (Item 5 - Parallel Commands)
-        char* parallel_commands[MAX_ARGS];                          // store the parallel commands
-        int parallel_count = 0;                                     // store the number of parallel commands
-        char* saveptr;                                              // keep track of the current position in the string for strtok_r
-        char* token = strtok_r(trimmed_input, "&", &saveptr);       // tokenize the input by splitting at the "&" character
+void name_set_clear(struct name_set *set) {
+    set->slots = NULL;              // the table belongs to the line arena
+    set->capacity = 0;
+    set->count = 0;
+}
 
-        while (token != NULL && parallel_count < MAX_ARGS) {        // store each token in the parallel commands array unless the max number of parallel commands is reached
-            char* trimmed_token = trim(token);                      // trim leading and trailing whitespace from the token
-            if (!is_empty_or_whitespace(trimmed_token)) {           // check if the token is not empty or contains only whitespace
-                parallel_commands[parallel_count++] = trimmed_token;// store the token in the parallel commands array
+// Helper function to check if a parsed line depends on the gathered commands:
+// it names a file that a gathered command redirects to, or it redirects to a file
+// that a gathered command names (and may still be reading)
+int depends_on_pending(struct command_line *parsed, struct name_set *pending_outputs, struct name_set *pending_words) {
+    for (int j = 0; j < parsed->command_count; j++) {
+        struct command *command = &parsed->commands[j];
+        if (command->output_file != NULL &&
+            (name_set_contains(pending_outputs, command->output_file) ||    // both commands write the same file
+             name_set_contains(pending_words, command->output_file))) {     // truncating a file a gathered command reads
+            return 1;
+        }
+        for (int k = 0; k < command->arg_count; k++) {
+            if (name_set_contains(pending_outputs, command->args[k])) {
+                return 1;                                   // the command reads (or otherwise uses) the file
             }
-            token = strtok_r(NULL, "&", &saveptr);                  // get the next token
         }
+    }
+    return 0;
+}
 
-        if (parallel_count == 0) {
-            continue;  // All parallel commands were empty
+// Run a script without prompts. In concurrent mode, consecutive lines of
+// external commands are gathered and run together through the job scheduler.
+// The gathered lines are run first (a barrier) before a built-in command, since it
+// changes shell state, before a line that names a file a gathered command
+// redirects to, since it depends on that command's output, and before a line that
+// redirects to a file a gathered command names, since it would overwrite that file.
+void run_batch(char *script, size_t length, int concurrent) {
+    char *end = script + length;
+    struct command *pending = NULL;                         // commands gathered from consecutive lines
+    int pending_count = 0;
+    int pending_capacity = 0;
+    struct name_set pending_outputs = {0};                  // files the gathered commands redirect to
+    struct name_set pending_words = {0};                    // words (possible input files) of the gathered commands
+
+    char *line = script;
+    while (line < end) {
+        char *newline = memchr(line, '\n', end - line);     // find the end of the current line
+        if (newline != NULL) {
+            *newline = '\0';                                // replace the newline character with a null terminator
         }
+        char *next = newline != NULL ? newline + 1 : end;
 
-        if (parallel_count > 1) {
-            execute_parallel_commands(parallel_commands, parallel_count);   // execute the parallel commands
+        if (!concurrent) {
+            if (process_line(line)) break;                  // run each line in order
+            line = next;
             continue;
         }
 
-        // Handle Single Command
-        char *args[MAX_ARGS];                                                     // store the arguments
-        char *output_file = NULL;                                                 // store the output file if found
-        int arg_count = parse_command(parallel_commands[0], args, &output_file);  // parse the command
+        if (pending_count == 0) {
+            arena_reset(&line_arena);                       // gathered lines keep their memory until they have run
+            name_set_clear(&pending_outputs);
+            name_set_clear(&pending_words);
+        }
+        struct command_line parsed;
+        int parse_result = parse_line(line, &line_arena, &parsed);
+
+        // Barrier: run the gathered commands before anything that must come after them
+        if (pending_count > 0 &&
+            (parse_result == -1 ||                                          // keep error output in script order
+             (parsed.command_count == 1 && is_builtin(parsed.commands[0].args[0])) ||
+             depends_on_pending(&parsed, &pending_outputs, &pending_words))) {
+            execute_parallel_commands(pending, pending_count);
+            pending_count = 0;
+            name_set_clear(&pending_outputs);
+            name_set_clear(&pending_words);
+        }
 
-        if (arg_count == -1) {      // check if there was an error parsing the command
+        if (parse_result == -1) {                           // check if there was an error parsing the line
             print_error();
+            line = next;
             continue;
         }
 
-        if (arg_count == 0) {       // check if there are no arguments
+        if (parsed.command_count == 1 && is_builtin(parsed.commands[0].args[0])) {
+            if (run_command_line(&parsed)) break;
+            line = next;
             continue;
         }
 
-        // Handle Built-in Commands (Item 3 - Built-in Commands)
-        if (strcmp(args[0], "exit") == 0) {         // check if the command is "exit"
-            if (arg_count > 1) {                    // should be the only argument
-                print_error();
-            } else {
-                break;
+        for (int i = 0; i < parsed.command_count; i++) {    // gather the commands of this line
+            if (pending_count == pending_capacity) {        // grow the gathered command list
+                pending_capacity = pending_capacity > 0 ? pending_capacity * 2 : INITIAL_CAPACITY;
+                pending = realloc(pending, sizeof(struct command) * pending_capacity);
             }
-        } else if (strcmp(args[0], "cd") == 0) {    // check if the command is "cd"
-            if (arg_count != 2) {                   // should have exactly 1 argument
-                print_error();
-            } else if (chdir(args[1]) != 0) {       // if change in directory is unsuccessful
-                print_error();
+            pending[pending_count++] = parsed.commands[i];
+
+            if (parsed.commands[i].output_file != NULL) {   // remember the file so later lines can depend on it
+                name_set_add(&line_arena, &pending_outputs, parsed.commands[i].output_file);
             }
-        } else if (strcmp(args[0], "path") == 0) {                          // check if the command is "path"
-            char **new_path = malloc(sizeof(char *) * (arg_count - 1));     // allocate memory for the new path
-            for (int i = 1; i < arg_count; i++) {                           // for each path in the arguments
-                new_path[i - 1] = strdup(args[i]);                          // store the path in the new path
+            for (int k = 0; k < parsed.commands[i].arg_count; k++) {   // remember the words so later lines do not overwrite them
+                name_set_add(&line_arena, &pending_words, parsed.commands[i].args[k]);
             }
-            update_path(new_path, arg_count - 1);                           // update the path
-        } else {
-            execute_command(args[0], args, output_file);                    // execute the command
+        }
+        line = next;
+    }
+
+    if (pending_count > 0) {                                // run whatever is left at the end of the script
+        execute_parallel_commands(pending, pending_count);
+    }
+    free(pending);
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: rush [[-p] script]  (-p runs independent script lines concurrently)
+    int concurrent = argc == 3 && strcmp(argv[1], "-p") == 0;
+    if (argc > 3 || (argc == 3 && !concurrent)) {       // check for unexpected arguments
+        print_error();
+        exit(1);
+    }
+    initialize_path();                  // initialize the path
+    initialize_max_jobs();              // initialize the parallel command limit
+
+    char *input = NULL;                 // store the input
+    size_t input_size = 0;              // store the size of the input
+    ssize_t line_length;                // store the length of the input
+
+    if (argc > 1) {                     // Batch Mode: run the script file without prompts
+        size_t script_length;
+        char *script = read_script(argv[argc - 1], &script_length);
+        if (script == NULL) {           // script cannot be opened or read
+            print_error();
+            exit(1);
+        }
+        run_batch(script, script_length, concurrent);
+        free(script);
+    } else while (1) {                  // Interactive Mode: prompt for each line
+        printf("rush> ");               // print the prompt
+        fflush(stdout);                 // flush the output buffer to ensure the prompt is displayed
+
+        line_length = getline(&input, &input_size, stdin);  // read the input from the user
+
+        if (line_length == -1) {        // check if the input is empty
+            break;
+        }
+
+        if (input[line_length - 1] == '\n') {   // remove the newline character from the input
+            input[line_length - 1] = '\0';      // replace the newline character with a null terminator
+        }
+
+        if (process_line(input)) {      // run the line and stop if it was "exit"
+            break;
         }
     }
 
@@ -294,5 +798,9 @@ int main(int argc, char *argv[]) {
     }
     free(path);    // free the path array
 
+    arena_free(&line_arena);    // free the line memory
+
+    write_stats();              // write the session stats if enabled, then free them
+
     return 0;
 }